@@ -0,0 +1,509 @@
+// Training throughput benchmark for the C++ XOR implementations of scenario 1.
+//
+// Every implementation is compiled into this program (each source file is included
+// into its own namespace, with its main() renamed) and run in a separate child process,
+// so that peak RSS is measured per implementation:
+//
+//   raw-sgd, raw-batch64   from_c++/macierze_XOR.cpp (per-sample SGD / mini-batch 64)
+//   mlp-arena              from_c++/macierze_XOR.cpp (arena-backed MLP engine, batch 64)
+//   matrix                 from_python/Claude/cpp_translation_claude_fixed.cpp (Matrix class)
+//   eigen                  from_python/Gemini/cpp_translation_gemini_fixed.cpp (Eigen)
+//   python-chatgpt         from_python/ChatGPT/cpp_translation_chatgpt_fixed.cpp (Eigen)
+//   python-deepseek        from_python/DeepSeek/cpp_translation_deepseek_fixed.cpp
+//   java-*                 from_java/*/cpp_translation_*.cpp
+//
+// The first five are driven on a scaled-up synthetic data set (noisy XOR) through the
+// implementation's own types and functions. "fwd ns" is the time of a forward-only pass
+// per sample, "bwd ns" is the rest of a training step (backward pass + update) per sample.
+// The python-* and java-* translations hard-code the 4-sample data set inside main(), so
+// they are timed as whole programs (10000 epochs over 4 samples) and have no per-pass split.
+// Eigen allocates through malloc rather than operator new, so allocations of the Eigen
+// implementations are not counted.
+//
+// Usage: benchmark_xor [--samples N] [--epochs E] [implementation]
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <array>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <memory>
+#include <initializer_list>
+#include <type_traits>
+#include <fstream>
+#include <stdexcept>
+#include <limits>
+#include <cerrno>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <io.h>
+#include <fcntl.h>
+#pragma comment(lib, "psapi.lib")
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+#define NULL_DEVICE "NUL"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+#include <cstdio>
+#include <Eigen/Dense>
+
+// Heap allocation counter for all implementations. The replacements are kept out of
+// line for the same reason as in macierze_XOR.cpp (-Wmismatched-new-delete).
+static std::atomic<size_t> benchAllocations{ 0 };
+
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE void* operator new(size_t size) {
+    ++benchAllocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// AlignedAllocator (from_python/Claude) allocates through the aligned overloads
+BENCH_NOINLINE void* operator new(size_t size, std::align_val_t alignment) {
+    ++benchAllocations;
+    const size_t align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+    if (void* p = _aligned_malloc(size ? size : 1, align))
+#else
+    // aligned_alloc wants a multiple of the alignment
+    if (void* p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+#endif
+        return p;
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void* p, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+BENCH_NOINLINE void operator delete(void* p, size_t, std::align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
+
+#define XOR_NO_ALLOCATION_HOOK
+
+namespace raw {
+#define main raw_main
+#include "from_c++/macierze_XOR.cpp"
+#undef main
+}
+
+namespace matrix {
+#define main matrix_main
+#include "from_python/Claude/cpp_translation_claude_fixed.cpp"
+#undef main
+}
+
+namespace eigen {
+#define main eigen_main
+#include "from_python/Gemini/cpp_translation_gemini_fixed.cpp"
+#undef main
+}
+
+namespace python_chatgpt {
+#define main python_chatgpt_main
+#include "from_python/ChatGPT/cpp_translation_chatgpt_fixed.cpp"
+#undef main
+}
+
+namespace python_deepseek {
+#define main python_deepseek_main
+#include "from_python/DeepSeek/cpp_translation_deepseek_fixed.cpp"
+#undef main
+}
+
+namespace java_chatgpt {
+#define main java_chatgpt_main
+#include "from_java/ChatGPT/cpp_translation_chatgpt.cpp"
+#undef main
+}
+
+namespace java_claude {
+#define main java_claude_main
+#include "from_java/Claude/cpp_translation_claude.cpp"
+#undef main
+}
+
+namespace java_deepseek {
+#define main java_deepseek_main
+#include "from_java/DeepSeek/cpp_translation_deepseek.cpp"
+#undef main
+}
+
+namespace java_gemini {
+#define main java_gemini_main
+#include "from_java/Gemini/cpp_translation_gemini_fixed.cpp"
+#undef main
+}
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct BenchConfig {
+    size_t samples = 4096;
+    int epochs = 200;
+};
+
+struct BenchResult {
+    double samplesPerSecond = 0;
+    double forwardNs = -1;   // per sample, -1 when not measurable
+    double backwardNs = -1;
+    double allocationsPerEpoch = 0;
+    bool allocationsCounted = true;  // Eigen allocates with malloc, bypassing operator new
+};
+
+double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Peak resident set size of this process in MiB
+double peakRssMiB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);  // bytes
+#else
+    return usage.ru_maxrss / 1024.0;             // KiB
+#endif
+#endif
+}
+
+// Noisy XOR, shared by every scaled-up run
+vector<raw::Sample> makeData(size_t n) {
+    return raw::makeSyntheticXor(n, 42);
+}
+
+// Times `epochs` calls of trainEpoch() and `epochs` calls of forwardEpoch() over `samples`
+// samples; the training step time minus the forward time is reported as backward
+template <typename Train, typename Forward>
+BenchResult measure(const BenchConfig& config, Train trainEpoch, Forward forwardEpoch) {
+    trainEpoch();  // warm-up, lets lazily sized buffers reach steady state
+
+    BenchResult result;
+    size_t allocationsBefore = benchAllocations;
+    auto start = Clock::now();
+    for (int epoch = 0; epoch < config.epochs; ++epoch)
+        trainEpoch();
+    double trainSeconds = secondsSince(start);
+    result.allocationsPerEpoch = double(benchAllocations - allocationsBefore) / config.epochs;
+
+    start = Clock::now();
+    for (int epoch = 0; epoch < config.epochs; ++epoch)
+        forwardEpoch();
+    double forwardSeconds = secondsSince(start);
+
+    const double samples = double(config.samples) * config.epochs;
+    result.samplesPerSecond = samples / trainSeconds;
+    result.forwardNs = forwardSeconds * 1e9 / samples;
+    result.backwardNs = max(0.0, (trainSeconds - forwardSeconds) * 1e9 / samples);
+    return result;
+}
+
+BenchResult benchRaw(const BenchConfig& config, int batchSize) {
+    vector<raw::Sample> data = makeData(config.samples);
+    raw::Network net(2, 4);
+    raw::TrainingWorkspace ws(2, 4, batchSize);
+    const double learningRate = 0.1 / batchSize;
+
+    return measure(config,
+        [&] {
+            for (size_t first = 0; first < data.size(); first += batchSize) {
+                int n = (int)min<size_t>(batchSize, data.size() - first);
+                raw::trainBatch(net, ws, data, first, n, learningRate);
+            }
+        },
+        [&] {
+            for (size_t first = 0; first < data.size(); first += batchSize) {
+                int n = (int)min<size_t>(batchSize, data.size() - first);
+                raw::loadBatch(data, first, n, 2, ws);
+                raw::forwardBatch(net, ws, n);
+            }
+        });
+}
+
+BenchResult benchMlpArena(const BenchConfig& config) {
+    const int batchSize = 64;
+    vector<raw::Sample> data = makeData(config.samples);
+    raw::MLP<double> mlp({ 2, 4, 1 }, batchSize);
+    const double learningRate = 0.1 / batchSize;
+
+    return measure(config,
+        [&] {
+            for (size_t first = 0; first < data.size(); first += batchSize) {
+                int n = (int)min<size_t>(batchSize, data.size() - first);
+                mlp.trainBatch(data, first, n, learningRate);
+            }
+        },
+        [&] {
+            for (size_t first = 0; first < data.size(); first += batchSize) {
+                int n = (int)min<size_t>(batchSize, data.size() - first);
+                mlp.predict(data, first, n);
+            }
+        });
+}
+
+// Full-batch gradient descent, step for step as in the translation's main()
+BenchResult benchMatrix(const BenchConfig& config) {
+    using matrix::Matrix;
+    vector<raw::Sample> data = makeData(config.samples);
+    vector<vector<double>> xs, ys;
+    for (const raw::Sample& s : data) {
+        xs.push_back(s.input);
+        ys.push_back({ s.output });
+    }
+    Matrix X(xs), y(ys);
+    mt19937 gen(42);
+    Matrix W1(2, 4), b1(1, 4), W2(4, 1), b2(1, 1);
+    W1.randomize(gen);
+    W2.randomize(gen);
+    const double learning_rate = 0.1 / config.samples;
+
+    return measure(config,
+        [&] {
+            Matrix z1 = X * W1 + b1;
+            Matrix a1 = matrix::relu(z1);
+            Matrix z2 = a1 * W2 + b2;
+            Matrix a2 = matrix::sigmoid(z2);
+
+            Matrix dz2 = (a2 - y).hadamard(matrix::sigmoid_derivative(z2));
+            Matrix dz1 = (dz2 * W2.transpose()).hadamard(matrix::relu_derivative(z1));
+
+            W2 -= learning_rate * (a1.transpose() * dz2);
+            b2 -= learning_rate * dz2.sum_axis0();
+            W1 -= learning_rate * (X.transpose() * dz1);
+            b1 -= learning_rate * dz1.sum_axis0();
+        },
+        [&] {
+            Matrix a1 = matrix::relu(X * W1 + b1);
+            Matrix a2 = matrix::sigmoid(a1 * W2 + b2);
+            (void)a2;
+        });
+}
+
+BenchResult benchEigen(const BenchConfig& config) {
+    vector<raw::Sample> data = makeData(config.samples);
+    const Eigen::Index n = (Eigen::Index)data.size();
+    Eigen::MatrixXd X(n, 2), y(n, 1);
+    for (Eigen::Index i = 0; i < n; ++i) {
+        X(i, 0) = data[i].input[0];
+        X(i, 1) = data[i].input[1];
+        y(i, 0) = data[i].output;
+    }
+    srand(42);
+    Eigen::MatrixXd W1 = Eigen::MatrixXd::Random(2, 4);
+    Eigen::MatrixXd b1 = Eigen::MatrixXd::Zero(1, 4);
+    Eigen::MatrixXd W2 = Eigen::MatrixXd::Random(4, 1);
+    Eigen::MatrixXd b2 = Eigen::MatrixXd::Zero(1, 1);
+    const double learning_rate = 0.1 / config.samples;
+
+    BenchResult result = measure(config,
+        [&] {
+            Eigen::MatrixXd z1 = X * W1 + b1.replicate(X.rows(), 1);
+            Eigen::MatrixXd a1 = eigen::relu(z1);
+            Eigen::MatrixXd z2 = a1 * W2 + b2.replicate(a1.rows(), 1);
+            Eigen::MatrixXd a2 = eigen::sigmoid(z2);
+
+            Eigen::MatrixXd dz2 = (a2 - y).array() * eigen::sigmoid_derivative(z2).array();
+            Eigen::MatrixXd dW2 = a1.transpose() * dz2;
+            Eigen::MatrixXd db2 = dz2.colwise().sum();
+            Eigen::MatrixXd dz1 = (dz2 * W2.transpose()).array() * eigen::relu_derivative(z1).array();
+            Eigen::MatrixXd dW1 = X.transpose() * dz1;
+            Eigen::MatrixXd db1 = dz1.colwise().sum();
+
+            W2 -= learning_rate * dW2;
+            b2 -= learning_rate * db2;
+            W1 -= learning_rate * dW1;
+            b1 -= learning_rate * db1;
+        },
+        [&] {
+            Eigen::MatrixXd a1 = eigen::relu(X * W1 + b1.replicate(X.rows(), 1));
+            Eigen::MatrixXd a2 = eigen::sigmoid(a1 * W2 + b2.replicate(a1.rows(), 1));
+            (void)a2;
+        });
+    result.allocationsCounted = false;
+    return result;
+}
+
+// Runs an unmodified translation's main() with its output (cout and printf) discarded
+BenchResult benchWholeProgram(int (*programMain)(), bool allocationsCounted = true) {
+    const double epochs = 10000, samples = 4;
+    cout.flush();
+    fflush(stdout);
+    int savedStdout = dup(1);
+    FILE* sink = fopen(NULL_DEVICE, "w");
+    dup2(fileno(sink), 1);
+
+    size_t allocationsBefore = benchAllocations;
+    auto start = Clock::now();
+    programMain();
+    cout.flush();
+    fflush(stdout);
+    double seconds = secondsSince(start);
+
+    dup2(savedStdout, 1);
+    close(savedStdout);
+    fclose(sink);
+    BenchResult result;
+    result.samplesPerSecond = epochs * samples / seconds;
+    result.allocationsPerEpoch = (benchAllocations - allocationsBefore) / epochs;
+    result.allocationsCounted = allocationsCounted;
+    return result;
+}
+
+struct Implementation {
+    const char* name;
+    const char* source;
+    BenchResult (*run)(const BenchConfig&);
+};
+
+const Implementation IMPLEMENTATIONS[] = {
+    { "raw-sgd", "from_c++/macierze_XOR.cpp", [](const BenchConfig& c) { return benchRaw(c, 1); } },
+    { "raw-batch64", "from_c++/macierze_XOR.cpp", [](const BenchConfig& c) { return benchRaw(c, 64); } },
+    { "mlp-arena", "from_c++/macierze_XOR.cpp", benchMlpArena },
+    { "matrix", "from_python/Claude", benchMatrix },
+    { "eigen", "from_python/Gemini", benchEigen },
+    { "python-chatgpt", "from_python/ChatGPT", [](const BenchConfig&) { return benchWholeProgram(python_chatgpt::python_chatgpt_main, false); } },
+    { "python-deepseek", "from_python/DeepSeek", [](const BenchConfig&) { return benchWholeProgram(python_deepseek::python_deepseek_main); } },
+    { "java-chatgpt", "from_java/ChatGPT", [](const BenchConfig&) { return benchWholeProgram(java_chatgpt::java_chatgpt_main); } },
+    { "java-claude", "from_java/Claude", [](const BenchConfig&) { return benchWholeProgram(java_claude::java_claude_main); } },
+    { "java-deepseek", "from_java/DeepSeek", [](const BenchConfig&) { return benchWholeProgram(java_deepseek::java_deepseek_main); } },
+    { "java-gemini", "from_java/Gemini", [](const BenchConfig&) { return benchWholeProgram(java_gemini::java_gemini_main); } },
+};
+
+void printHeader(const BenchConfig& config) {
+    cout << "Scaled runs: " << config.samples << " noisy XOR samples, 2-4-1 network, "
+        << config.epochs << " epochs; python-*, java-*: original 4-sample program, 10000 epochs\n\n";
+    cout << left << setw(15) << "implementation" << right
+        << setw(14) << "samples/s" << setw(10) << "fwd ns" << setw(10) << "bwd ns"
+        << setw(13) << "peak RSS MiB" << setw(14) << "allocs/epoch" << "   source" << endl;
+}
+
+void printRow(const Implementation& impl, const BenchResult& r) {
+    auto number = [](double v) {
+        ostringstream s;
+        if (v < 0)
+            s << "-";
+        else
+            s << std::fixed << setprecision(1) << v;
+        return s.str();
+    };
+    cout << left << setw(15) << impl.name << right << std::fixed
+        << setw(14) << setprecision(0) << r.samplesPerSecond
+        << setw(10) << number(r.forwardNs) << setw(10) << number(r.backwardNs)
+        << setw(13) << setprecision(1) << peakRssMiB()
+        << setw(14) << (r.allocationsCounted ? number(r.allocationsPerEpoch) : string("-"))
+        << "   " << impl.source << endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    const Implementation* only = nullptr;
+    // Counts must be whole positive numbers in full, e.g. "--epochs 20x" is an error
+    auto count = [](const string& option, const char* text, long long maximum) {
+        char* end = nullptr;
+        errno = 0;
+        long long value = strtoll(text, &end, 10);
+        if (end == text || *end != '\0' || errno == ERANGE || value < 1 || value > maximum)
+            throw runtime_error("Invalid value '" + string(text) + "' for " + option);
+        return value;
+    };
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if ((arg == "--samples" || arg == "--epochs") && i + 1 >= argc)
+                throw runtime_error(arg + " expects a value");
+            if (arg == "--samples")
+                config.samples = (size_t)count(arg, argv[++i], numeric_limits<int>::max());
+            else if (arg == "--epochs")
+                config.epochs = (int)count(arg, argv[++i], numeric_limits<int>::max());
+            else if (arg.size() > 1 && arg[0] == '-')
+                throw runtime_error("Unknown option " + arg);
+            else if (only)
+                throw runtime_error("Only one implementation can be given, got " + string(only->name) + " and " + arg);
+            else {
+                for (const Implementation& impl : IMPLEMENTATIONS) {
+                    if (arg == impl.name)
+                        only = &impl;
+                }
+                if (!only) {
+                    string names;
+                    for (const Implementation& impl : IMPLEMENTATIONS)
+                        names += string(names.empty() ? "" : ", ") + impl.name;
+                    throw runtime_error("Unknown implementation " + arg + " (one of: " + names + ")");
+                }
+            }
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Error: " << e.what() << "\nUsage: " << argv[0] << " [--samples N] [--epochs E] [implementation]" << endl;
+        return 1;
+    }
+
+    // Child mode: run one implementation in this process and print its row
+    if (only) {
+        printRow(*only, only->run(config));
+        return 0;
+    }
+
+    printHeader(config);
+    for (const Implementation& impl : IMPLEMENTATIONS) {
+        ostringstream command;
+        command << "\"" << argv[0] << "\" --samples " << config.samples << " --epochs " << config.epochs
+            << " " << impl.name;
+        if (system(command.str().c_str()) != 0)
+            cerr << impl.name << ": benchmark failed" << endl;
+    }
+    return 0;
+}
+
+// Build (from 1_macierze_siec_xor/):
+// g++ -std=c++17 -O2 -pthread -I/usr/include/eigen3 -o benchmark_xor benchmark_xor.cpp
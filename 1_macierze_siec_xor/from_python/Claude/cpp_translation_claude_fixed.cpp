@@ -3,88 +3,160 @@
 #include <cmath>
 #include <random>
 #include <iomanip>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
 
-class Matrix {
-public:
-    std::vector<std::vector<double>> data;
+// Cache-line aligned allocator, so every Matrix buffer starts on a 64-byte boundary
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+// Read-only strided view over a Matrix buffer (used for transpose without copying)
+struct MatrixView {
+    const double* ptr;
     int rows, cols;
+    int row_stride, col_stride;
+
+    MatrixView(const double* p, int r, int c, int rs, int cs)
+        : ptr(p), rows(r), cols(c), row_stride(rs), col_stride(cs) {}
 
-    Matrix(int r, int c) : rows(r), cols(c) {
-        data.resize(r, std::vector<double>(c, 0.0));
+    double operator()(int i, int j) const {
+        return ptr[i * row_stride + j * col_stride];
     }
 
-    Matrix(std::vector<std::vector<double>> values) {
-        data = values;
-        rows = data.size();
-        cols = data[0].size();
+    // Swapping the strides transposes the view in O(1)
+    MatrixView transpose() const {
+        return { ptr, cols, rows, col_stride, row_stride };
     }
+};
+
+// Expression templates: +, -, scalar *, hadamard and the activation functions build
+// lazy nodes instead of Matrix temporaries. The whole element-wise chain is evaluated
+// in a single loop when it is assigned to a Matrix. Every node provides
+//   nrows(), ncols()  - shape
+//   at(i, j)          - element (i, j) of the result
+//   prepare()         - called once before evaluation (materializes matrix products)
+// Nodes keep references to Matrix operands, so an expression must be consumed in the
+// statement that builds it.
+template <typename E>
+struct MatExpr {
+    const E& self() const { return static_cast<const E&>(*this); }
+
+    // Element-wise multiplication
+    template <typename R>
+    auto hadamard(const MatExpr<R>& other) const;
+};
 
-    // Matrix multiplication
-    Matrix operator*(const Matrix& other) const {
-        Matrix result(rows, other.cols);
+struct Product;
+template <typename E>
+struct ScaleExpr;
+
+class Matrix : public MatExpr<Matrix> {
+public:
+    // Row-major, one contiguous buffer: element (i, j) lives at data[i * cols + j]
+    std::vector<double, AlignedAllocator<double>> data;
+    int rows, cols;
+
+    Matrix(int r, int c) : data(static_cast<std::size_t>(r) * c, 0.0), rows(r), cols(c) {}
+
+    Matrix(std::vector<std::vector<double>> values) {
+        rows = values.size();
+        cols = values[0].size();
+        data.resize(static_cast<std::size_t>(rows) * cols);
         for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < other.cols; j++) {
-                for (int k = 0; k < cols; k++) {
-                    result.data[i][j] += data[i][k] * other.data[k][j];
-                }
-            }
+            std::copy(values[i].begin(), values[i].end(), row(i));
         }
-        return result;
     }
 
-    // Matrix addition
-    Matrix operator+(const Matrix& other) const {
-        Matrix result(rows, cols);
+    // Materialize a (possibly strided) view
+    explicit Matrix(const MatrixView& v) : Matrix(v.rows, v.cols) {
         for (int i = 0; i < rows; i++) {
             for (int j = 0; j < cols; j++) {
-                result.data[i][j] = data[i][j] + other.data[0][j];
+                (*this)(i, j) = v(i, j);
             }
         }
-        return result;
     }
 
-    // Matrix subtraction
-    Matrix operator-(const Matrix& other) const {
-        Matrix result(rows, cols);
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
-                result.data[i][j] = data[i][j] - other.data[i][j];
-            }
-        }
-        return result;
+    // Evaluate an expression in one pass
+    template <typename E>
+    Matrix(const MatExpr<E>& e) : Matrix(e.self().nrows(), e.self().ncols()) {
+        assign(e.self());
     }
 
-    // Scalar multiplication
-    Matrix operator*(double scalar) const {
-        Matrix result(rows, cols);
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
-                result.data[i][j] = data[i][j] * scalar;
-            }
+    // Matrix product, multiplied straight into the new buffer
+    Matrix(const Product& p);
+
+    Matrix(const Matrix&) = default;
+    Matrix(Matrix&&) = default;
+    Matrix& operator=(const Matrix&) = default;
+    Matrix& operator=(Matrix&&) = default;
+
+    template <typename E>
+    Matrix& operator=(const MatExpr<E>& e) {
+        const E& expr = e.self();
+        if (expr.nrows() != rows || expr.ncols() != cols) {
+            return *this = Matrix(expr);
         }
-        return result;
+        // Element (i, j) is read before it is written, so X = X - ... is safe
+        assign(expr);
+        return *this;
     }
 
-    // Transpose
-    Matrix transpose() const {
-        Matrix result(cols, rows);
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
-                result.data[j][i] = data[i][j];
-            }
-        }
-        return result;
+    Matrix& operator=(const Product& p) {
+        return *this = Matrix(p);
     }
 
-    // Element-wise multiplication
-    Matrix hadamard(const Matrix& other) const {
-        Matrix result(rows, cols);
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
-                result.data[i][j] = data[i][j] * other.data[i][j];
-            }
-        }
-        return result;
+    template <typename E>
+    Matrix& operator+=(const MatExpr<E>& e);
+
+    template <typename E>
+    Matrix& operator-=(const MatExpr<E>& e);
+
+    // W -= scale * (A * B): accumulated by the multiply kernel, no product temporary
+    Matrix& operator-=(const ScaleExpr<Product>& e);
+
+    double& operator()(int i, int j) { return data[i * cols + j]; }
+    double operator()(int i, int j) const { return data[i * cols + j]; }
+
+    double* row(int i) { return data.data() + static_cast<std::size_t>(i) * cols; }
+    const double* row(int i) const { return data.data() + static_cast<std::size_t>(i) * cols; }
+
+    operator MatrixView() const {
+        return { data.data(), rows, cols, cols, 1 };
+    }
+
+    // Expression node interface
+    int nrows() const { return rows; }
+    int ncols() const { return cols; }
+    double at(int i, int j) const { return data[i * cols + j]; }
+    void prepare() const {}
+
+    // Transpose (strided view, no copy)
+    MatrixView transpose() const {
+        return MatrixView(*this).transpose();
     }
 
     // Initialize with random values
@@ -92,7 +164,7 @@ public:
         std::normal_distribution<double> dist(0.0, 1.0);
         for (int i = 0; i < rows; i++) {
             for (int j = 0; j < cols; j++) {
-                data[i][j] = dist(gen);
+                (*this)(i, j) = dist(gen);
             }
         }
     }
@@ -100,9 +172,11 @@ public:
     // Sum along axis (0 for columns)
     Matrix sum_axis0() const {
         Matrix result(1, cols);
-        for (int j = 0; j < cols; j++) {
-            for (int i = 0; i < rows; i++) {
-                result.data[0][j] += data[i][j];
+        double* out = result.row(0);
+        for (int i = 0; i < rows; i++) {
+            const double* in = row(i);
+            for (int j = 0; j < cols; j++) {
+                out[j] += in[j];
             }
         }
         return result;
@@ -111,68 +185,249 @@ public:
     // Mean squared error
     double mse(const Matrix& target) const {
         double sum = 0.0;
-        int count = 0;
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
-                double diff = data[i][j] - target.data[i][j];
-                sum += diff * diff;
-                count++;
-            }
+        for (std::size_t n = 0; n < data.size(); n++) {
+            double diff = data[n] - target.data[n];
+            sum += diff * diff;
         }
-        return sum / count;
+        return sum / data.size();
     }
 
     // Print matrix
     void print() const {
         for (int i = 0; i < rows; i++) {
             for (int j = 0; j < cols; j++) {
-                std::cout << std::fixed << std::setprecision(2) << data[i][j] << " ";
+                std::cout << std::fixed << std::setprecision(2) << (*this)(i, j) << " ";
             }
             std::cout << std::endl;
         }
     }
+
+private:
+    bool overlaps(const MatrixView& v) const {
+        return v.ptr >= data.data() && v.ptr < data.data() + data.size();
+    }
+
+    template <typename E>
+    void assign(const E& expr) {
+        expr.prepare();
+        for (int i = 0; i < rows; i++) {
+            double* out = row(i);
+            for (int j = 0; j < cols; j++) {
+                out[j] = expr.at(i, j);
+            }
+        }
+    }
 };
 
-// Activation functions
-Matrix relu(const Matrix& x) {
-    Matrix result(x.rows, x.cols);
-    for (int i = 0; i < x.rows; i++) {
-        for (int j = 0; j < x.cols; j++) {
-            result.data[i][j] = std::max(0.0, x.data[i][j]);
+// Matrix multiplication: out += alpha * a * b in i-k-j order, tiled so that a block
+// of b's rows stays in cache while it is reused for every row of a. Either operand
+// may be a transposed view; the strides are followed directly
+constexpr int MATMUL_BLOCK = 64;
+
+void multiply_add(const MatrixView& a, const MatrixView& b, double alpha, Matrix& result) {
+    for (int ii = 0; ii < a.rows; ii += MATMUL_BLOCK) {
+        const int i_end = std::min(ii + MATMUL_BLOCK, a.rows);
+        for (int kk = 0; kk < a.cols; kk += MATMUL_BLOCK) {
+            const int k_end = std::min(kk + MATMUL_BLOCK, a.cols);
+            for (int jj = 0; jj < b.cols; jj += MATMUL_BLOCK) {
+                const int j_end = std::min(jj + MATMUL_BLOCK, b.cols);
+                for (int i = ii; i < i_end; i++) {
+                    double* out = result.row(i);
+                    for (int k = kk; k < k_end; k++) {
+                        const double a_ik = alpha * a(i, k);
+                        if (b.col_stride == 1) {
+                            const double* b_row = b.ptr + static_cast<std::size_t>(k) * b.row_stride;
+                            for (int j = jj; j < j_end; j++) {
+                                out[j] += a_ik * b_row[j];
+                            }
+                        }
+                        else {
+                            for (int j = jj; j < j_end; j++) {
+                                out[j] += a_ik * b(k, j);
+                            }
+                        }
+                    }
+                }
+            }
         }
     }
-    return result;
 }
 
-Matrix relu_derivative(const Matrix& x) {
-    Matrix result(x.rows, x.cols);
-    for (int i = 0; i < x.rows; i++) {
-        for (int j = 0; j < x.cols; j++) {
-            result.data[i][j] = (x.data[i][j] > 0) ? 1.0 : 0.0;
+// Lazy matrix product. Assigned to a Matrix (or subtracted from one) it multiplies
+// straight into the destination; used inside an element-wise expression it is
+// materialized once by prepare()
+struct Product : MatExpr<Product> {
+    MatrixView a, b;
+    mutable std::vector<double, AlignedAllocator<double>> value;
+
+    Product(const MatrixView& a, const MatrixView& b) : a(a), b(b) {}
+
+    int nrows() const { return a.rows; }
+    int ncols() const { return b.cols; }
+    double at(int i, int j) const { return value[i * b.cols + j]; }
+
+    void prepare() const {
+        if (value.empty()) {
+            Matrix result(*this);
+            value = std::move(result.data);
         }
     }
-    return result;
+};
+
+Product operator*(const MatrixView& a, const MatrixView& b) {
+    return Product(a, b);
 }
 
-Matrix sigmoid(const Matrix& x) {
-    Matrix result(x.rows, x.cols);
-    for (int i = 0; i < x.rows; i++) {
-        for (int j = 0; j < x.cols; j++) {
-            result.data[i][j] = 1.0 / (1.0 + std::exp(-x.data[i][j]));
-        }
+inline Matrix::Matrix(const Product& p) : Matrix(p.a.rows, p.b.cols) {
+    multiply_add(p.a, p.b, 1.0, *this);
+}
+
+// Leaves are held by reference, intermediate nodes by value
+template <typename E>
+using ExprOperand = std::conditional_t<std::is_same<E, Matrix>::value, const Matrix&, E>;
+
+template <typename Op, typename L, typename R>
+struct BinaryExpr : MatExpr<BinaryExpr<Op, L, R>> {
+    ExprOperand<L> lhs;
+    ExprOperand<R> rhs;
+
+    BinaryExpr(const L& l, const R& r) : lhs(l), rhs(r) {}
+
+    int nrows() const { return lhs.nrows(); }
+    int ncols() const { return lhs.ncols(); }
+    double at(int i, int j) const { return Op::apply(lhs, rhs, i, j); }
+    void prepare() const { lhs.prepare(); rhs.prepare(); }
+};
+
+template <typename E>
+struct ScaleExpr : MatExpr<ScaleExpr<E>> {
+    ExprOperand<E> operand;
+    double scalar;
+
+    ScaleExpr(const E& e, double s) : operand(e), scalar(s) {}
+
+    int nrows() const { return operand.nrows(); }
+    int ncols() const { return operand.ncols(); }
+    double at(int i, int j) const { return operand.at(i, j) * scalar; }
+    void prepare() const { operand.prepare(); }
+};
+
+template <typename Op, typename E>
+struct UnaryExpr : MatExpr<UnaryExpr<Op, E>> {
+    ExprOperand<E> operand;
+
+    explicit UnaryExpr(const E& e) : operand(e) {}
+
+    int nrows() const { return operand.nrows(); }
+    int ncols() const { return operand.ncols(); }
+    double at(int i, int j) const { return Op::apply(operand.at(i, j)); }
+    void prepare() const { operand.prepare(); }
+};
+
+// Matrix addition (broadcasts a 1 x cols row vector over every row)
+struct AddOp {
+    template <typename L, typename R>
+    static double apply(const L& l, const R& r, int i, int j) {
+        return l.at(i, j) + r.at(r.nrows() == 1 ? 0 : i, j);
+    }
+};
+
+struct SubOp {
+    template <typename L, typename R>
+    static double apply(const L& l, const R& r, int i, int j) { return l.at(i, j) - r.at(i, j); }
+};
+
+struct MulOp {
+    template <typename L, typename R>
+    static double apply(const L& l, const R& r, int i, int j) { return l.at(i, j) * r.at(i, j); }
+};
+
+template <typename L, typename R>
+BinaryExpr<AddOp, L, R> operator+(const MatExpr<L>& l, const MatExpr<R>& r) {
+    return { l.self(), r.self() };
+}
+
+// Matrix subtraction
+template <typename L, typename R>
+BinaryExpr<SubOp, L, R> operator-(const MatExpr<L>& l, const MatExpr<R>& r) {
+    return { l.self(), r.self() };
+}
+
+// Scalar multiplication
+template <typename E>
+ScaleExpr<E> operator*(const MatExpr<E>& e, double scalar) {
+    return { e.self(), scalar };
+}
+
+template <typename E>
+ScaleExpr<E> operator*(double scalar, const MatExpr<E>& e) {
+    return { e.self(), scalar };
+}
+
+template <typename E>
+template <typename R>
+auto MatExpr<E>::hadamard(const MatExpr<R>& other) const {
+    return BinaryExpr<MulOp, E, R>(self(), other.self());
+}
+
+template <typename E>
+Matrix& Matrix::operator+=(const MatExpr<E>& e) {
+    return *this = *this + e;
+}
+
+template <typename E>
+Matrix& Matrix::operator-=(const MatExpr<E>& e) {
+    return *this = *this - e;
+}
+
+inline Matrix& Matrix::operator-=(const ScaleExpr<Product>& e) {
+    const Product& p = e.operand;
+    if (overlaps(p.a) || overlaps(p.b)) {
+        // The product reads this matrix: multiply into a temporary first
+        return *this = *this - Matrix(p) * e.scalar;
     }
-    return result;
+    multiply_add(p.a, p.b, -e.scalar, *this);
+    return *this;
 }
 
-Matrix sigmoid_derivative(const Matrix& x) {
-    Matrix s = sigmoid(x);
-    Matrix ones(s.rows, s.cols);
-    for (int i = 0; i < s.rows; i++) {
-        for (int j = 0; j < s.cols; j++) {
-            ones.data[i][j] = 1.0;
-        }
+// Activation functions
+struct ReluOp {
+    static double apply(double x) { return std::max(0.0, x); }
+};
+
+struct ReluDerivativeOp {
+    static double apply(double x) { return (x > 0) ? 1.0 : 0.0; }
+};
+
+struct SigmoidOp {
+    static double apply(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+};
+
+struct SigmoidDerivativeOp {
+    static double apply(double x) {
+        double s = SigmoidOp::apply(x);
+        return s * (1.0 - s);
     }
-    return s.hadamard(ones - s);
+};
+
+template <typename E>
+UnaryExpr<ReluOp, E> relu(const MatExpr<E>& x) {
+    return UnaryExpr<ReluOp, E>(x.self());
+}
+
+template <typename E>
+UnaryExpr<ReluDerivativeOp, E> relu_derivative(const MatExpr<E>& x) {
+    return UnaryExpr<ReluDerivativeOp, E>(x.self());
+}
+
+template <typename E>
+UnaryExpr<SigmoidOp, E> sigmoid(const MatExpr<E>& x) {
+    return UnaryExpr<SigmoidOp, E>(x.self());
+}
+
+template <typename E>
+UnaryExpr<SigmoidDerivativeOp, E> sigmoid_derivative(const MatExpr<E>& x) {
+    return UnaryExpr<SigmoidDerivativeOp, E>(x.self());
 }
 
 int main() {
@@ -220,18 +475,13 @@ int main() {
 
         // Backward pass
         Matrix dz2 = (a2 - y).hadamard(sigmoid_derivative(z2));
-        Matrix dW2 = a1.transpose() * dz2;
-        Matrix db2 = dz2.sum_axis0();
-
         Matrix dz1 = (dz2 * W2.transpose()).hadamard(relu_derivative(z1));
-        Matrix dW1 = X.transpose() * dz1;
-        Matrix db1 = dz1.sum_axis0();
 
-        // Update weights and biases
-        W2 = W2 - dW2 * learning_rate;
-        b2 = b2 - db2 * learning_rate;
-        W1 = W1 - dW1 * learning_rate;
-        b1 = b1 - db1 * learning_rate;
+        // Update weights and biases (the weight gradients are multiplied straight into W)
+        W2 -= learning_rate * (a1.transpose() * dz2);
+        b2 -= learning_rate * dz2.sum_axis0();
+        W1 -= learning_rate * (X.transpose() * dz1);
+        b1 -= learning_rate * dz1.sum_axis0();
 
         // Print progress
         if (epoch % 1000 == 0) {
@@ -249,4 +499,4 @@ int main() {
     predictions.print();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,10 +1,613 @@
 #include <pqxx/pqxx>
 #include <iostream>
 #include <string>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <stdexcept>
+#include <cstdlib>
+#include <iomanip>
+#include <fstream>
+#include <functional>
+#include <tuple>
+#include <cstdio>
+#include <list>
+#include <unordered_map>
+#include <optional>
+#include <cstdint>
+#include <future>
+#include <type_traits>
+#include <algorithm>
+#include <set>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <limits>
 
 using namespace std;
 using namespace pqxx;
 
+const char* CONNECTION_STRING = "host=localhost port=5432 dbname=master_thesis user=postgres password=9";
+
+// A server-side prepared statement with typed parameters. Statements are prepared once
+// per connection by prepare_statements() (the pool's on_connect hook), so calls only
+// send the name and the parameters; the server does not parse and plan the SQL again.
+template<typename... Args>
+struct PreparedStatement {
+    const char* name;
+    const char* sql;
+
+    result operator()(transaction_base& tx, const Args&... args) const {
+        return tx.exec_prepared(name, args...);
+    }
+};
+
+const PreparedStatement<string> USER_ID_BY_EMAIL{ "user_id_by_email",
+    "SELECT id FROM users WHERE email = $1" };
+const PreparedStatement<int, string, double> INSERT_ORDER{ "insert_order",
+    "INSERT INTO orders (user_id, product, amount) VALUES ($1, $2, $3)" };
+const PreparedStatement<double> ORDERS_OVER{ "orders_over", R"(
+        SELECT
+            u.name AS user_name,
+            u.email,
+            o.product,
+            o.amount,
+            o.order_date
+        FROM orders o
+        JOIN users u ON o.user_id = u.id
+        WHERE o.amount > $1
+        ORDER BY o.amount DESC;
+    )" };
+const PreparedStatement<double> COUNT_ORDERS_OVER{ "count_orders_over",
+    "SELECT COUNT(*) FROM orders WHERE amount > $1" };
+// Keyset pagination over the orders_over ordering, extended with o.id as a tie-breaker.
+// The next page starts strictly after the (amount, id) of the previous page's last row;
+// orders_amount_id_idx lets the server seek straight there, so every page costs the
+// same no matter how deep it is.
+const PreparedStatement<double, int> ORDERS_OVER_FIRST_PAGE{ "orders_over_first_page", R"(
+        SELECT o.id, u.name AS user_name, u.email, o.product, o.amount, o.order_date
+        FROM orders o
+        JOIN users u ON o.user_id = u.id
+        WHERE o.amount > $1
+        ORDER BY o.amount DESC, o.id DESC
+        LIMIT $2
+    )" };
+const PreparedStatement<double, string, int, int> ORDERS_OVER_NEXT_PAGE{ "orders_over_next_page", R"(
+        SELECT o.id, u.name AS user_name, u.email, o.product, o.amount, o.order_date
+        FROM orders o
+        JOIN users u ON o.user_id = u.id
+        WHERE o.amount > $1 AND (o.amount, o.id) < ($2::numeric, $3)
+        ORDER BY o.amount DESC, o.id DESC
+        LIMIT $4
+    )" };
+const PreparedStatement<vector<int>> ORDERS_FOR_USERS{ "orders_for_users", R"(
+        SELECT user_id, id, product, amount, order_date
+        FROM orders
+        WHERE user_id = ANY($1::int[])
+        ORDER BY user_id, id
+    )" };
+
+// Prepares every statement above on a new connection. The tables must already exist.
+void prepare_statements(connection& conn) {
+    const pair<const char*, const char*> all[] = {
+        { USER_ID_BY_EMAIL.name, USER_ID_BY_EMAIL.sql },
+        { INSERT_ORDER.name, INSERT_ORDER.sql },
+        { ORDERS_OVER.name, ORDERS_OVER.sql },
+        { COUNT_ORDERS_OVER.name, COUNT_ORDERS_OVER.sql },
+        { ORDERS_FOR_USERS.name, ORDERS_FOR_USERS.sql },
+        { ORDERS_OVER_FIRST_PAGE.name, ORDERS_OVER_FIRST_PAGE.sql },
+        { ORDERS_OVER_NEXT_PAGE.name, ORDERS_OVER_NEXT_PAGE.sql },
+    };
+    for (const auto& [name, sql] : all)
+        conn.prepare(name, sql);
+}
+
+// Thread-safe pool of open connections.
+//
+// acquire() hands out an idle connection, opening a new one while fewer than max_size
+// exist and otherwise waiting (up to acquire_timeout) for one to be released. The
+// returned Lease gives the connection back when it goes out of scope; a connection
+// that was closed or marked with discard() is dropped instead. An idle connection
+// that has not been used for health_check_interval is checked with "SELECT 1" before
+// it is handed out. A background thread closes connections idle for longer than
+// idle_timeout (never going below min_size) and reopens connections up to min_size.
+// Connections are opened and checked outside the pool lock. on_connect runs once on
+// every newly opened connection (including replacements for broken ones), so session
+// state such as prepared statements is set up again after a reconnect.
+class ConnectionPool {
+public:
+    struct Options {
+        size_t min_size = 2;
+        size_t max_size = 8;
+        chrono::milliseconds acquire_timeout{ 5000 };
+        chrono::seconds health_check_interval{ 30 };
+        chrono::seconds idle_timeout{ 300 };
+        function<void(connection&)> on_connect;
+    };
+
+    class Lease {
+    public:
+        Lease(Lease&& other) noexcept : pool(other.pool), conn(move(other.conn)), broken(other.broken) {
+            other.pool = nullptr;
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+
+        ~Lease() {
+            if (pool)
+                pool->release(move(conn), broken);
+        }
+
+        connection& operator*() const { return *conn; }
+        connection* operator->() const { return conn.get(); }
+
+        // Do not return this connection to the pool (e.g. its session state is unknown)
+        void discard() { broken = true; }
+
+    private:
+        friend class ConnectionPool;
+        Lease(ConnectionPool* pool, unique_ptr<connection> conn) : pool(pool), conn(move(conn)) {}
+
+        ConnectionPool* pool;
+        unique_ptr<connection> conn;
+        bool broken = false;
+    };
+
+    ConnectionPool(string conninfo, Options options)
+        : conninfo(move(conninfo)), options(options) {
+        if (this->options.max_size == 0 || this->options.min_size > this->options.max_size)
+            throw invalid_argument("ConnectionPool: need 0 <= min_size <= max_size, max_size > 0");
+        // The maintenance thread wakes up every min(idle_timeout, 10 s); zero would make it spin
+        if (this->options.idle_timeout <= chrono::seconds::zero())
+            throw invalid_argument("ConnectionPool: idle_timeout must be positive");
+        for (size_t i = 0; i < this->options.min_size; ++i)
+            idle.push_back({ open_connection(), chrono::steady_clock::now(), chrono::steady_clock::now() });
+        total = idle.size();
+        maintainer = thread([this] { maintain(); });
+    }
+
+    // Every Lease must be gone before the pool is destroyed
+    ~ConnectionPool() {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        wake_maintainer.notify_all();
+        maintainer.join();
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    Lease acquire() {
+        const auto deadline = chrono::steady_clock::now() + options.acquire_timeout;
+        for (;;) {
+            unique_lock<mutex> lock(m);
+            if (!available.wait_until(lock, deadline, [&] { return !idle.empty() || total < options.max_size; }))
+                throw runtime_error("ConnectionPool: no connection available within the acquire timeout");
+
+            if (!idle.empty()) {
+                Entry entry = move(idle.back());   // most recently used: warm and least likely to be stale
+                idle.pop_back();
+                lock.unlock();
+                if (healthy(entry))
+                    return Lease(this, move(entry.conn));
+                forget();
+                continue;
+            }
+
+            ++total;   // reserve the slot, connect without holding the lock
+            lock.unlock();
+            try {
+                return Lease(this, open_connection());
+            }
+            catch (...) {
+                forget();
+                throw;
+            }
+        }
+    }
+
+    size_t size() const {
+        lock_guard<mutex> lock(m);
+        return total;
+    }
+
+    size_t idle_count() const {
+        lock_guard<mutex> lock(m);
+        return idle.size();
+    }
+
+private:
+    struct Entry {
+        unique_ptr<connection> conn;
+        chrono::steady_clock::time_point last_used;
+        chrono::steady_clock::time_point last_checked;
+    };
+
+    unique_ptr<connection> open_connection() {
+        auto conn = make_unique<connection>(conninfo);
+        if (!conn->is_open())
+            throw broken_connection("ConnectionPool: cannot connect to database");
+        if (options.on_connect)
+            options.on_connect(*conn);
+        return conn;
+    }
+
+    bool healthy(Entry& entry) {
+        if (!entry.conn->is_open())
+            return false;
+        const auto now = chrono::steady_clock::now();
+        if (now - entry.last_checked < options.health_check_interval)
+            return true;
+        try {
+            nontransaction tx(*entry.conn);
+            tx.exec("SELECT 1");
+            entry.last_checked = now;
+            return true;
+        }
+        catch (const exception&) {
+            return false;
+        }
+    }
+
+    void release(unique_ptr<connection> conn, bool broken) {
+        if (broken || !conn->is_open()) {
+            conn.reset();
+            forget();
+            return;
+        }
+        const auto now = chrono::steady_clock::now();
+        {
+            lock_guard<mutex> lock(m);
+            idle.push_back({ move(conn), now, now });
+        }
+        available.notify_one();
+    }
+
+    // A connection left the pool for good
+    void forget() {
+        {
+            lock_guard<mutex> lock(m);
+            --total;
+        }
+        available.notify_one();
+    }
+
+    // Background thread: idle reaping and keeping min_size connections open
+    void maintain() {
+        const auto period = min<chrono::milliseconds>(options.idle_timeout, chrono::seconds(10));
+        unique_lock<mutex> lock(m);
+        while (!stopping) {
+            wake_maintainer.wait_for(lock, period, [&] { return stopping; });
+            if (stopping)
+                break;
+
+            // Oldest idle connections are at the front
+            vector<unique_ptr<connection>> expired;
+            const auto now = chrono::steady_clock::now();
+            while (!idle.empty() && total > options.min_size && now - idle.front().last_used >= options.idle_timeout) {
+                expired.push_back(move(idle.front().conn));
+                idle.pop_front();
+                --total;
+            }
+
+            while (total < options.min_size) {
+                ++total;
+                lock.unlock();
+                expired.clear();
+                try {
+                    auto conn = open_connection();
+                    lock.lock();
+                    idle.push_back({ move(conn), chrono::steady_clock::now(), chrono::steady_clock::now() });
+                    available.notify_one();
+                }
+                catch (const exception& e) {
+                    cerr << "ConnectionPool: " << e.what() << endl;
+                    lock.lock();
+                    --total;
+                    break;   // retry on the next round
+                }
+            }
+
+            lock.unlock();
+            expired.clear();   // close outside the lock
+            lock.lock();
+        }
+    }
+
+    const string conninfo;
+    const Options options;
+    mutable mutex m;
+    condition_variable available;        // acquire() waiters
+    condition_variable wake_maintainer;
+    deque<Entry> idle;                   // least recently used first
+    size_t total = 0;
+    bool stopping = false;
+    thread maintainer;
+};
+
+// Email -> user id cache with LRU eviction, kept coherent with the database through
+// LISTEN/NOTIFY. A trigger on users (see setup_schema) sends the old email on channel
+// users_changed when a user's email or id changes or the user is deleted, and an empty
+// payload on TRUNCATE. A background thread listens on its own connection and drops the
+// affected entries, so an entry can be stale only between the commit and the arrival
+// of the notification. Whenever the listener (re)connects the whole cache is cleared,
+// since notifications sent while it was not listening are lost.
+// Lookups should not run in transactions that modify users: an uncommitted change that
+// is rolled back sends no notification.
+class UserIdCache {
+public:
+    static constexpr const char* CHANNEL = "users_changed";
+
+    UserIdCache(size_t capacity, string conninfo)
+        : capacity(max<size_t>(1, capacity)), conninfo(move(conninfo)) {
+        listener = thread([this] { listen(); });
+    }
+
+    ~UserIdCache() {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        wake_listener.notify_all();
+        listener.join();   // the listener checks `stopping` at least once a second
+    }
+
+    UserIdCache(const UserIdCache&) = delete;
+    UserIdCache& operator=(const UserIdCache&) = delete;
+
+    // Returns the id of the user with `email`, querying the database on a miss.
+    // Unknown emails are not cached.
+    optional<int> lookup(transaction_base& tx, const string& email) {
+        uint64_t seen_generation;
+        {
+            lock_guard<mutex> lock(m);
+            auto it = index.find(email);
+            if (it != index.end()) {
+                entries.splice(entries.begin(), entries, it->second);
+                ++hit_count;
+                return it->second->second;
+            }
+            ++miss_count;
+            seen_generation = generation;
+        }
+
+        result r = USER_ID_BY_EMAIL(tx, email);
+        if (r.empty())
+            return nullopt;
+        int id = r[0]["id"].as<int>();
+
+        lock_guard<mutex> lock(m);
+        // An invalidation that arrived during the query may concern this very row
+        if (generation == seen_generation && index.find(email) == index.end()) {
+            entries.emplace_front(email, id);
+            index.emplace(email, entries.begin());
+            if (entries.size() > capacity) {
+                index.erase(entries.back().first);
+                entries.pop_back();
+                ++eviction_count;
+            }
+        }
+        return id;
+    }
+
+    void invalidate(const string& email) {
+        lock_guard<mutex> lock(m);
+        ++generation;
+        ++invalidation_count;
+        auto it = index.find(email);
+        if (it != index.end()) {
+            entries.erase(it->second);
+            index.erase(it);
+        }
+    }
+
+    // Drops every entry, e.g. after TRUNCATE or when notifications may have been missed
+    void clear() {
+        lock_guard<mutex> lock(m);
+        ++generation;
+        ++clear_count;
+        entries.clear();
+        index.clear();
+    }
+
+    size_t hits() const { return hit_count; }
+    size_t misses() const { return miss_count; }
+    size_t evictions() const { return eviction_count; }
+    size_t invalidations() const { return invalidation_count; }   // single emails
+    size_t clears() const { return clear_count; }
+
+    size_t size() const {
+        lock_guard<mutex> lock(m);
+        return entries.size();
+    }
+
+    void print_stats(ostream& out) const {
+        size_t h = hits(), lookups = h + misses();
+        out << "user id cache: " << h << " hits, " << misses() << " misses ("
+            << fixed << setprecision(1) << (lookups ? 100.0 * h / lookups : 0.0) << "% hit rate), "
+            << evictions() << " evictions, " << invalidations() << " invalidations, " << clears() << " clears, "
+            << size() << "/" << capacity << " entries\n";
+    }
+
+private:
+    class Receiver : public notification_receiver {
+    public:
+        Receiver(connection& conn, UserIdCache& cache) : notification_receiver(conn, CHANNEL), cache(cache) {}
+
+        void operator()(const string& payload, int) override {
+            if (payload.empty())
+                cache.clear();
+            else
+                cache.invalidate(payload);
+        }
+
+    private:
+        UserIdCache& cache;
+    };
+
+    bool should_stop() {
+        lock_guard<mutex> lock(m);
+        return stopping;
+    }
+
+    void listen() {
+        while (!should_stop()) {
+            try {
+                connection conn(conninfo);
+                Receiver receiver(conn, *this);   // issues LISTEN
+                clear();
+                while (!should_stop())
+                    conn.await_notification(1, 0);
+            }
+            catch (const exception& e) {
+                cerr << "UserIdCache: " << e.what() << endl;
+                clear();
+                unique_lock<mutex> lock(m);
+                wake_listener.wait_for(lock, chrono::seconds(1), [&] { return stopping; });
+            }
+        }
+    }
+
+    const size_t capacity;
+    const string conninfo;
+    mutable mutex m;
+    list<pair<string, int>> entries;   // most recently used first
+    unordered_map<string, list<pair<string, int>>::iterator> index;
+    uint64_t generation = 0;           // bumped by every invalidation
+    atomic<size_t> hit_count{ 0 };
+    atomic<size_t> miss_count{ 0 };
+    atomic<size_t> eviction_count{ 0 };
+    atomic<size_t> invalidation_count{ 0 };
+    atomic<size_t> clear_count{ 0 };
+    bool stopping = false;
+    condition_variable wake_listener;
+    thread listener;
+};
+
+// Runs queries asynchronously on a fixed set of worker threads. Every worker owns one
+// connection (set up with on_connect, like the pool's) and runs one task at a time, so
+// tasks need no locking around the connection. submit() takes any callable taking a
+// connection& and returns a future for its result; exceptions thrown by the task, or
+// by opening the connection, are delivered through the future. A worker whose
+// connection broke opens a new one for its next task. The destructor finishes all
+// queued tasks before stopping the workers.
+class QueryExecutor {
+public:
+    QueryExecutor(string conninfo, size_t workers, function<void(connection&)> on_connect = nullptr)
+        : conninfo(move(conninfo)), on_connect(move(on_connect)) {
+        for (size_t i = 0; i < max<size_t>(1, workers); ++i)
+            threads.emplace_back([this] { work_loop(); });
+    }
+
+    ~QueryExecutor() {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        task_ready.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    template<typename F>
+    auto submit(F task) -> future<invoke_result_t<F&, connection&>> {
+        using R = invoke_result_t<F&, connection&>;
+        auto done = make_shared<promise<R>>();
+        auto handle = done->get_future();
+        auto run = [done, task = move(task)](connection* conn, exception_ptr error) mutable {
+            if (error) {
+                done->set_exception(error);
+                return;
+            }
+            try {
+                if constexpr (is_void_v<R>) {
+                    task(*conn);
+                    done->set_value();
+                }
+                else
+                    done->set_value(task(*conn));
+            }
+            catch (...) {
+                done->set_exception(current_exception());
+            }
+        };
+        {
+            lock_guard<mutex> lock(m);
+            if (stopping)
+                throw logic_error("QueryExecutor: submit() after shutdown");
+            queue.push_back(move(run));
+        }
+        task_ready.notify_one();
+        return handle;
+    }
+
+    // Runs `sql` in its own read-only transaction
+    future<result> query(string sql) {
+        return submit([sql = move(sql)](connection& conn) {
+            read_transaction tx(conn);
+            result r = tx.exec(sql);
+            tx.commit();
+            return r;
+        });
+    }
+
+    size_t worker_count() const { return threads.size(); }
+
+private:
+    using Task = function<void(connection*, exception_ptr)>;
+
+    void work_loop() {
+        unique_ptr<connection> conn;
+        for (;;) {
+            Task task;
+            {
+                unique_lock<mutex> lock(m);
+                task_ready.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;   // stopping, and everything queued has run
+                task = move(queue.front());
+                queue.pop_front();
+            }
+
+            if (conn && !conn->is_open())
+                conn.reset();
+            exception_ptr error;
+            if (!conn) {
+                try {
+                    conn = make_unique<connection>(conninfo);
+                    if (on_connect)
+                        on_connect(*conn);
+                }
+                catch (...) {
+                    conn.reset();
+                    error = current_exception();
+                }
+            }
+            task(conn.get(), error);
+        }
+    }
+
+    const string conninfo;
+    const function<void(connection&)> on_connect;
+    mutex m;
+    condition_variable task_ready;
+    deque<Task> queue;
+    bool stopping = false;
+    vector<thread> threads;
+};
+
 void setup_schema(work& tx) {
     tx.exec(R"(
         CREATE TABLE IF NOT EXISTS users (
@@ -23,87 +626,1068 @@ void setup_schema(work& tx) {
             order_date TIMESTAMP DEFAULT CURRENT_TIMESTAMP
         );
     )");
+
+    // Keyset pagination of orders by amount (scanned backwards for DESC)
+    tx.exec("CREATE INDEX IF NOT EXISTS orders_amount_id_idx ON orders (amount, id)");
+
+    // Invalidation messages for UserIdCache. The triggers are only created when missing:
+    // dropping and recreating them on every start would lock users against all other
+    // clients and leave a window with no invalidations. A changed trigger definition
+    // therefore needs a new trigger name. duplicate_object covers a concurrent start.
+    tx.exec(R"(
+        CREATE OR REPLACE FUNCTION notify_users_changed() RETURNS trigger AS $$
+        BEGIN
+            IF TG_OP = 'TRUNCATE' THEN
+                PERFORM pg_notify('users_changed', '');
+            ELSE
+                PERFORM pg_notify('users_changed', OLD.email);
+            END IF;
+            RETURN NULL;
+        END;
+        $$ LANGUAGE plpgsql;
+
+        DO $$
+        BEGIN
+            IF NOT EXISTS (SELECT 1 FROM pg_trigger WHERE tgrelid = 'users'::regclass AND tgname = 'users_changed') THEN
+                CREATE TRIGGER users_changed AFTER UPDATE OF id, email OR DELETE ON users
+                    FOR EACH ROW EXECUTE FUNCTION notify_users_changed();
+            END IF;
+            IF NOT EXISTS (SELECT 1 FROM pg_trigger WHERE tgrelid = 'users'::regclass AND tgname = 'users_truncated') THEN
+                CREATE TRIGGER users_truncated AFTER TRUNCATE ON users
+                    FOR EACH STATEMENT EXECUTE FUNCTION notify_users_changed();
+            END IF;
+        EXCEPTION WHEN duplicate_object THEN
+            NULL;
+        END;
+        $$;
+    )");
+}
+
+// Sends `statements` to the server as one pipelined batch and returns their results in
+// the same order. The server runs them one after another, in order, in tx's transaction,
+// so a statement sees the rows written by the ones before it. What it cannot do is use
+// an earlier result on the client side, e.g. to build its own SQL. An error in any of
+// them is thrown when its result is collected, and it aborts the transaction, so the
+// statements after it fail too.
+vector<result> run_pipelined(transaction_base& tx, const vector<string>& statements) {
+    pipeline p(tx);
+    p.retain(static_cast<int>(statements.size()));   // hold the batch back until it is complete
+    vector<pipeline::query_id> ids;
+    ids.reserve(statements.size());
+    for (const auto& sql : statements)
+        ids.push_back(p.insert(sql));
+    p.resume();
+
+    vector<result> results;
+    results.reserve(ids.size());
+    for (auto id : ids)
+        results.push_back(p.retrieve(id));
+    return results;
 }
 
+// Alicja's id and the "has no orders yet" check are resolved in SQL, so the whole setup
+// is one pipelined batch instead of six dependent round trips. The orders INSERT relies
+// on the batch order: it reads the user row the first statement has just inserted.
+// Pipelined statements must not end with a semicolon.
 void insert_sample_data(work& tx) {
-    // insert users
-    tx.exec(R"(
+    run_pipelined(tx, {
+        R"(
         INSERT INTO users (name, email)
         VALUES 
             ('Alicja', 'alice@example.com'),
             ('Bartek', 'bartek@example.com'),
             ('Celina', 'celina@example.com')
-        ON CONFLICT (email) DO NOTHING;
-    )");
+        ON CONFLICT (email) DO NOTHING
+        )",
+        R"(
+        INSERT INTO orders (user_id, product, amount)
+        SELECT u.id, v.product, v.amount
+        FROM users u
+        CROSS JOIN (VALUES ('Laptop', 3200.00), ('Mouse', 120.00), ('Keyboard', 90.00)) AS v(product, amount)
+        WHERE u.email = 'alice@example.com'
+            AND NOT EXISTS (SELECT 1 FROM orders o WHERE o.user_id = u.id)
+        )"
+    });
+}
 
-    // take Alicja's id
-    result r = tx.exec("SELECT id FROM users WHERE email = 'alice@example.com'");
-    if (r.empty()) return;
+void query_and_process(work& tx) {
+    result r = ORDERS_OVER(tx, 100.0);
 
-    int user_id_alice = r[0]["id"].as<int>();
+    cout << "Orders over 100 zl:\n\n";
+    for (auto row : r) {
+        cout << row["user_name"].c_str() << " (" << row["email"].c_str() << ") ordered "
+            << row["product"].c_str() << " for " << row["amount"].c_str()
+            << " zł on " << row["order_date"].c_str() << "\n";
+    }
+}
 
-    // check if there are orders
-    result cnt = tx.exec_params("SELECT COUNT(*) FROM orders WHERE user_id = $1", user_id_alice);
-    if (cnt[0]["count"].as<long>() == 0) {
-        tx.exec_params(
-            "INSERT INTO orders (user_id, product, amount) VALUES ($1, $2, $3)",
-            user_id_alice, "Laptop", 3200.00
-        );
-        tx.exec_params(
-            "INSERT INTO orders (user_id, product, amount) VALUES ($1, $2, $3)",
-            user_id_alice, "Mouse", 120.00
-        );
-        tx.exec_params(
-            "INSERT INTO orders (user_id, product, amount) VALUES ($1, $2, $3)",
-            user_id_alice, "Keyboard", 90.00
-        );
+double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Collects output in a fixed-size block and hands it to the stream one block at a time,
+// instead of one stream insertion per field
+class BufferedWriter {
+public:
+    static constexpr size_t CAPACITY = 64 * 1024;
+
+    explicit BufferedWriter(ostream& out) : out(out) { buf.reserve(CAPACITY); }
+    ~BufferedWriter() { out.write(buf.data(), buf.size()); }
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    BufferedWriter& operator<<(string_view s) {
+        if (buf.size() + s.size() > CAPACITY)
+            flush();
+        buf.append(s.data(), s.size());
+        return *this;
+    }
+
+    BufferedWriter& operator<<(double value) {
+        char text[32];
+        int n = snprintf(text, sizeof(text), "%.2f", value);
+        return *this << string_view(text, n);
     }
+
+    void flush() {
+        out.write(buf.data(), buf.size());
+        buf.clear();
+        if (!out)
+            throw runtime_error("BufferedWriter: write failed");
+    }
+
+private:
+    ostream& out;
+    string buf;
+};
+
+// Inserts an order for the user with `email`, resolving the id through the cache.
+// Returns false if there is no such user.
+bool place_order(work& tx, UserIdCache& cache, const string& email, const string& product, double amount) {
+    optional<int> user_id = cache.lookup(tx, email);
+    if (!user_id)
+        return false;
+    INSERT_ORDER(tx, *user_id, product, amount);
+    return true;
 }
 
-void query_and_process(work& tx) {
-    result r = tx.exec_params(R"(
+// Orders of a set of users, stored flat: one array of orders grouped by user, an offset
+// table into it, and all text fields back to back in one buffer. Building it costs a
+// few allocations in total instead of a few per order.
+class OrdersByUser {
+public:
+    struct Text {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct Order {
+        int id;
+        double amount;          // NULL amounts are 0
+        Text product;
+        Text order_date;
+    };
+
+    struct Range {
+        const Order* first;
+        const Order* last;
+        const Order* begin() const { return first; }
+        const Order* end() const { return last; }
+        size_t size() const { return last - first; }
+    };
+
+    // Distinct requested user ids, ascending
+    const vector<int>& users() const { return user_ids; }
+    size_t order_count() const { return orders.size(); }
+
+    // Empty for users with no orders and for ids that were not requested
+    Range orders_of(int user_id) const {
+        auto it = lower_bound(user_ids.begin(), user_ids.end(), user_id);
+        if (it == user_ids.end() || *it != user_id)
+            return { nullptr, nullptr };
+        size_t u = it - user_ids.begin();
+        return { orders.data() + offsets[u], orders.data() + offsets[u + 1] };
+    }
+
+    string_view text(Text t) const { return string_view(chars.data() + t.offset, t.length); }
+
+private:
+    friend OrdersByUser fetch_orders_for_users(transaction_base& tx, vector<int> user_ids);
+
+    Text append(string_view s) {
+        Text t{ static_cast<uint32_t>(chars.size()), static_cast<uint32_t>(s.size()) };
+        chars.append(s.data(), s.size());
+        return t;
+    }
+
+    vector<int> user_ids;
+    vector<uint32_t> offsets;   // orders of user_ids[u] are orders[offsets[u] .. offsets[u + 1])
+    vector<Order> orders;
+    string chars;
+};
+
+// Fetches the orders of all `user_ids` with a single array-parameter query instead of
+// one query per user. The rows arrive sorted by user, so grouping is a single pass.
+OrdersByUser fetch_orders_for_users(transaction_base& tx, vector<int> user_ids) {
+    sort(user_ids.begin(), user_ids.end());
+    user_ids.erase(unique(user_ids.begin(), user_ids.end()), user_ids.end());
+
+    OrdersByUser out;
+    result r = ORDERS_FOR_USERS(tx, user_ids);
+    out.user_ids = move(user_ids);
+    out.offsets.assign(out.user_ids.size() + 1, 0);
+    out.orders.reserve(r.size());
+    out.chars.reserve(r.size() * 32);
+
+    size_t u = 0;
+    for (auto row : r) {
+        int user_id = row["user_id"].as<int>();
+        while (u < out.user_ids.size() && out.user_ids[u] < user_id)
+            out.offsets[++u] = static_cast<uint32_t>(out.orders.size());
+        OrdersByUser::Order order;
+        order.id = row["id"].as<int>();
+        order.amount = row["amount"].as<double>(0.0);
+        order.product = out.append(row["product"].view());
+        order.order_date = out.append(row["order_date"].view());
+        out.orders.push_back(order);
+    }
+    while (u < out.user_ids.size())
+        out.offsets[++u] = static_cast<uint32_t>(out.orders.size());
+    return out;
+}
+
+// Fetches the orders of the first `users` users once per user and once batched
+void compare_batched_fetch(ConnectionPool& pool, int users) {
+    ConnectionPool::Lease conn = pool.acquire();
+    read_transaction tx(*conn);
+    vector<int> ids;
+    for (auto row : tx.exec_params("SELECT id FROM users ORDER BY id LIMIT $1", users))
+        ids.push_back(row["id"].as<int>());
+
+    auto start = chrono::steady_clock::now();
+    size_t looped = 0;
+    for (int id : ids)
+        looped += ORDERS_FOR_USERS(tx, vector<int>{ id }).size();
+    double per_user = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    OrdersByUser batch = fetch_orders_for_users(tx, ids);
+    double batched = seconds_since(start);
+    tx.commit();
+
+    double total = 0;
+    for (int id : batch.users())
+        for (const auto& order : batch.orders_of(id))
+            total += order.amount;
+
+    cout << "\n" << batch.order_count() << " orders (" << fixed << setprecision(2) << total << " zł) of "
+        << batch.users().size() << " users: batched 1 query " << setprecision(3) << batched << " s, "
+        << "per user " << ids.size() << " queries " << per_user << " s (" << looped << " orders)\n";
+}
+
+// One page of the orders-over-threshold listing
+struct OrdersPage {
+    result rows;         // id, user_name, email, product, amount, order_date
+    string next_token;   // pass to fetch_orders_page for the next page; empty after the last
+};
+
+// `token` is empty for the first page, otherwise the next_token of the previous page.
+// The token is opaque to callers; it holds the amount (as the exact NUMERIC text) and
+// the id of the last row. A full page always yields a token, so the page after the
+// last full one can be empty.
+OrdersPage fetch_orders_page(transaction_base& tx, double threshold, int page_size, const string& token = "") {
+    if (page_size <= 0)
+        throw invalid_argument("fetch_orders_page: page_size must be positive");
+
+    OrdersPage page;
+    if (token.empty())
+        page.rows = ORDERS_OVER_FIRST_PAGE(tx, threshold, page_size);
+    else {
+        // Both halves must parse completely, so a tampered token fails here rather than
+        // as a data_exception from the server
+        size_t sep = token.find('/');
+        string amount = token.substr(0, sep);
+        const char* id_text = sep == string::npos ? "" : token.c_str() + sep + 1;
+        char* amount_end = nullptr;
+        char* id_end = nullptr;
+        strtod(amount.c_str(), &amount_end);
+        long id = strtol(id_text, &id_end, 10);
+        if (amount.empty() || *amount_end != '\0' || amount.find_first_not_of("+-.0123456789eE") != string::npos
+            || *id_text == '\0' || *id_end != '\0' || id <= 0 || id > INT32_MAX)
+            throw invalid_argument("fetch_orders_page: malformed page token");
+        page.rows = ORDERS_OVER_NEXT_PAGE(tx, threshold, amount, static_cast<int>(id), page_size);
+    }
+
+    if (page.rows.size() == page_size) {
+        auto last = page.rows[page.rows.size() - 1];
+        page.next_token = string(last["amount"].c_str()) + "/" + last["id"].c_str();
+    }
+    return page;
+}
+
+// Walks the orders-over-threshold listing page by page and reports the cost of each page
+void walk_order_pages(transaction_base& tx, double threshold, int page_size) {
+    string token;
+    size_t total = 0;
+    for (int k = 1;; ++k) {
+        auto start = chrono::steady_clock::now();
+        OrdersPage page = fetch_orders_page(tx, threshold, page_size, token);
+        double ms = seconds_since(start) * 1000;
+        total += page.rows.size();
+        if (!page.rows.empty()) {
+            cout << "page " << k << ": " << page.rows.size() << " rows in " << fixed << setprecision(2) << ms
+                << " ms, amounts " << page.rows[0]["amount"].c_str() << " .. "
+                << page.rows[page.rows.size() - 1]["amount"].c_str() << "\n";
+        }
+        if (page.next_token.empty())
+            break;
+        token = page.next_token;
+    }
+    cout << total << " orders over " << threshold << "\n";
+}
+
+// Streaming variant of query_and_process. The rows come through COPY (pqxx::stream_from)
+// and are formatted as they arrive, so client memory does not grow with the size of the
+// result. COPY takes no parameters, so the threshold is quoted into the query. Returns
+// the number of rows written.
+size_t stream_orders_report(transaction_base& tx, double threshold, ostream& out) {
+    auto stream = stream_from::query(tx, R"(
         SELECT
-            u.name AS user_name,
+            u.name,
             u.email,
             o.product,
             o.amount,
-            o.order_date
+            COALESCE(o.order_date::text, '')
         FROM orders o
         JOIN users u ON o.user_id = u.id
-        WHERE o.amount > $1
-        ORDER BY o.amount DESC;
-    )", 100.0);
+        WHERE o.amount > )" + tx.quote(threshold) + R"(
+        ORDER BY o.amount DESC
+    )");
 
-    cout << "Orders over 100 zl:\n\n";
+    BufferedWriter writer(out);
+    size_t rows = 0;
+    // The string_views point into the current row and are only valid until the next one
+    for (auto [name, email, product, amount, order_date] : stream.iter<string_view, string_view, string_view, double, string_view>()) {
+        writer << name << " (" << email << ") ordered " << product << " for " << amount
+            << " zł on " << order_date << "\n";
+        ++rows;
+    }
+    stream.complete();
+    writer.flush();
+    return rows;
+}
+
+// Independent summary reports, run by --async-reports both one after another and in
+// parallel on a QueryExecutor
+const pair<const char*, const char*> REPORTS[] = {
+    { "top customers", R"(
+        SELECT u.email, COUNT(o.id) AS orders, COALESCE(SUM(o.amount), 0) AS total
+        FROM users u
+        LEFT JOIN orders o ON o.user_id = u.id
+        GROUP BY u.email
+        ORDER BY total DESC
+        LIMIT 10
+    )" },
+    { "revenue per product", R"(
+        SELECT product, COUNT(*) AS orders, SUM(amount) AS total
+        FROM orders
+        GROUP BY product
+        ORDER BY total DESC
+    )" },
+    { "last 7 days", R"(
+        SELECT order_date::date AS day, COUNT(*) AS orders, SUM(amount) AS total
+        FROM orders
+        GROUP BY day
+        ORDER BY day DESC
+        LIMIT 7
+    )" },
+    { "order size distribution", R"(
+        SELECT width_bucket(amount, 0, 5000, 10) AS bucket, COUNT(*) AS orders
+        FROM orders
+        GROUP BY bucket
+        ORDER BY bucket
+    )" },
+};
+
+void print_result(const char* title, const result& r) {
+    cout << title << ":\n";
     for (auto row : r) {
-        cout << row["user_name"].c_str() << " (" << row["email"].c_str() << ") ordered "
-            << row["product"].c_str() << " for " << row["amount"].c_str()
-            << " zł on " << row["order_date"].c_str() << "\n";
+        cout << " ";
+        for (auto field : row)
+            cout << " " << (field.is_null() ? "NULL" : field.c_str());
+        cout << "\n";
+    }
+}
+
+void run_async_reports(ConnectionPool& pool, size_t workers) {
+    auto start = chrono::steady_clock::now();
+    {
+        ConnectionPool::Lease conn = pool.acquire();
+        for (const auto& report : REPORTS) {
+            read_transaction tx(*conn);
+            tx.exec(report.second);
+            tx.commit();
+        }
+    }
+    double sequential = seconds_since(start);
+
+    QueryExecutor executor(CONNECTION_STRING, workers, prepare_statements);
+    start = chrono::steady_clock::now();
+    vector<future<result>> pending;
+    for (const auto& report : REPORTS)
+        pending.push_back(executor.query(report.second));
+    vector<result> results;
+    for (auto& f : pending)
+        results.push_back(f.get());
+    double parallel = seconds_since(start);
+
+    cout << "\n";
+    for (size_t i = 0; i < results.size(); ++i)
+        print_result(REPORTS[i].first, results[i]);
+    cout << "\n" << size(REPORTS) << " reports: sequential " << fixed << setprecision(3) << sequential
+        << " s, parallel on " << executor.worker_count() << " workers " << parallel
+        << " s (including connecting)\n";
+}
+
+// Minimal CSV reader: comma separated fields, optionally double-quoted ("" inside quotes
+// is a literal quote, quoted fields may span lines). The first line is a header and is
+// skipped, as are empty lines.
+class CsvReader {
+public:
+    explicit CsvReader(const string& path) : path(path), in(path, ios::binary) {
+        if (!in)
+            throw runtime_error("cannot open " + path);
+        vector<string> header;
+        next(header);
+    }
+
+    bool next(vector<string>& fields) {
+        streambuf* buf = in.rdbuf();
+        for (;;) {
+            fields.clear();
+            int c = buf->sbumpc();
+            if (c == EOF)
+                return false;
+            ++line_no;
+            string field;
+            bool quoted = false;
+            for (;; c = buf->sbumpc()) {
+                if (quoted) {
+                    if (c == EOF)
+                        throw runtime_error(where() + ": unterminated quoted field");
+                    if (c == '"' && buf->sgetc() == '"')
+                        field += char(buf->sbumpc());
+                    else if (c == '"')
+                        quoted = false;
+                    else {
+                        if (c == '\n')
+                            ++line_no;
+                        field += char(c);
+                    }
+                }
+                else if (c == '"')
+                    quoted = true;
+                else if (c == ',')
+                    fields.push_back(move(field)), field.clear();
+                else if (c == '\n' || c == EOF)
+                    break;
+                else if (c != '\r')
+                    field += char(c);
+            }
+            if (fields.empty() && field.empty())
+                continue;
+            fields.push_back(move(field));
+            return true;
+        }
+    }
+
+    string where() const { return path + ":" + to_string(line_no); }
+
+private:
+    string path;
+    ifstream in;
+    size_t line_no = 0;
+};
+
+// Bulk ingestion. Rows are streamed with COPY into a session-local staging table and
+// merged into the target table with a single INSERT ... SELECT, so a batch costs a few
+// round trips instead of one per row. Conflicts are resolved in the merge: users by
+// email according to ConflictPolicy (the last occurrence of a duplicated email in the
+// batch wins), orders are matched to users by email and dropped if there is no such user.
+enum class ConflictPolicy { Skip, Update };
+
+struct UserRecord {
+    string name;
+    string email;
+};
+
+struct OrderRecord {
+    string email;
+    string product;
+    double amount = 0;
+};
+
+struct IngestStats {
+    size_t streamed = 0;      // rows sent to the staging table
+    size_t merged = 0;        // rows inserted or updated in the target table
+    double copy_seconds = 0;
+    double merge_seconds = 0;
+};
+
+void print_ingest_stats(const char* table, const IngestStats& s) {
+    double total = s.copy_seconds + s.merge_seconds;
+    cout << table << ": " << s.streamed << " rows streamed, " << s.merged << " merged ("
+        << s.streamed - s.merged << " skipped) in " << fixed << setprecision(2) << total << " s, "
+        << setprecision(0) << (total > 0 ? s.streamed / total : 0) << " rows/s"
+        << " (COPY " << setprecision(2) << s.copy_seconds << " s, merge " << s.merge_seconds << " s)\n";
+}
+
+// `next` fills in the next row and returns false when there are no more
+IngestStats bulk_upsert_users(work& tx, const function<bool(UserRecord&)>& next, ConflictPolicy policy) {
+    IngestStats stats;
+    auto start = chrono::steady_clock::now();
+    tx.exec(R"(
+        CREATE TEMP TABLE IF NOT EXISTS staging_users (
+            seq BIGSERIAL,
+            name TEXT,
+            email TEXT
+        ) ON COMMIT DELETE ROWS;
+    )");
+    tx.exec("TRUNCATE staging_users");
+
+    auto stream = stream_to::table(tx, { "staging_users" }, { "name", "email" });
+    UserRecord user;
+    while (next(user)) {
+        stream.write_values(user.name, user.email);
+        ++stats.streamed;
+    }
+    stream.complete();
+    stats.copy_seconds = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    result r = tx.exec(string(R"(
+        INSERT INTO users (name, email)
+        SELECT DISTINCT ON (email) name, email
+        FROM staging_users
+        WHERE email IS NOT NULL
+        ORDER BY email, seq DESC
+    )") + (policy == ConflictPolicy::Update
+        ? "ON CONFLICT (email) DO UPDATE SET name = EXCLUDED.name WHERE users.name IS DISTINCT FROM EXCLUDED.name"
+        : "ON CONFLICT (email) DO NOTHING"));
+    stats.merged = r.affected_rows();
+    stats.merge_seconds = seconds_since(start);
+    return stats;
+}
+
+IngestStats bulk_insert_orders(work& tx, const function<bool(OrderRecord&)>& next) {
+    IngestStats stats;
+    auto start = chrono::steady_clock::now();
+    tx.exec(R"(
+        CREATE TEMP TABLE IF NOT EXISTS staging_orders (
+            email TEXT,
+            product TEXT,
+            amount NUMERIC(10,2)
+        ) ON COMMIT DELETE ROWS;
+    )");
+    tx.exec("TRUNCATE staging_orders");
+
+    auto stream = stream_to::table(tx, { "staging_orders" }, { "email", "product", "amount" });
+    OrderRecord order;
+    while (next(order)) {
+        stream.write_values(order.email, order.product, order.amount);
+        ++stats.streamed;
+    }
+    stream.complete();
+    stats.copy_seconds = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    tx.exec("ANALYZE staging_orders");   // temp tables have no statistics for the join otherwise
+    result r = tx.exec(R"(
+        INSERT INTO orders (user_id, product, amount)
+        SELECT u.id, s.product, s.amount
+        FROM staging_orders s
+        JOIN users u ON u.email = s.email
+    )");
+    stats.merged = r.affected_rows();
+    stats.merge_seconds = seconds_since(start);
+    return stats;
+}
+
+// users.csv: name,email    orders.csv: email,product,amount    (either path may be empty)
+void import_csv(work& tx, const string& users_path, const string& orders_path, ConflictPolicy policy) {
+    vector<string> fields;
+    if (!users_path.empty()) {
+        CsvReader csv(users_path);
+        print_ingest_stats("users", bulk_upsert_users(tx, [&](UserRecord& user) {
+            if (!csv.next(fields))
+                return false;
+            if (fields.size() != 2)
+                throw runtime_error(csv.where() + ": expected name,email");
+            user.name = move(fields[0]);
+            user.email = move(fields[1]);
+            return true;
+        }, policy));
+    }
+    if (!orders_path.empty()) {
+        CsvReader csv(orders_path);
+        print_ingest_stats("orders", bulk_insert_orders(tx, [&](OrderRecord& order) {
+            if (!csv.next(fields))
+                return false;
+            if (fields.size() != 3)
+                throw runtime_error(csv.where() + ": expected email,product,amount");
+            char* end = nullptr;
+            order.amount = strtod(fields[2].c_str(), &end);
+            if (fields[2].empty() || *end != '\0')
+                throw runtime_error(csv.where() + ": invalid amount '" + fields[2] + "'");
+            order.email = move(fields[0]);
+            order.product = move(fields[1]);
+            return true;
+        }));
+    }
+}
+
+// Generates `orders` synthetic orders spread over orders / 100 synthetic users
+void bulk_demo(work& tx, size_t orders, ConflictPolicy policy) {
+    static const char* const PRODUCTS[] = { "Laptop", "Mouse", "Keyboard", "Monitor", "Headphones" };
+    const size_t users = max<size_t>(1, orders / 100);
+    auto email_of = [](size_t i) { return "bulk" + to_string(i) + "@example.com"; };
+
+    size_t i = 0;
+    print_ingest_stats("users", bulk_upsert_users(tx, [&](UserRecord& user) {
+        if (i == users)
+            return false;
+        user.name = "Bulk user " + to_string(i);
+        user.email = email_of(i++);
+        return true;
+    }, policy));
+
+    i = 0;
+    print_ingest_stats("orders", bulk_insert_orders(tx, [&](OrderRecord& order) {
+        if (i == orders)
+            return false;
+        order.email = email_of(i % users);
+        order.product = PRODUCTS[i % size(PRODUCTS)];
+        order.amount = 10 + (i * 37) % 5000 + 0.99;
+        ++i;
+        return true;
+    }));
+}
+
+// Runs `requests` short read transactions on `threads` worker threads, each request on
+// a pooled connection with prepared statements (or on a freshly opened one, sending
+// the SQL text), and reports requests per second
+void run_concurrent_requests(ConnectionPool* pool, int threads, int requests) {
+    atomic<int> next{ 0 };
+    atomic<int> failures{ 0 };
+    auto worker = [&] {
+        while (next++ < requests) {
+            try {
+                if (pool) {
+                    ConnectionPool::Lease conn = pool->acquire();
+                    read_transaction tx(*conn);
+                    COUNT_ORDERS_OVER(tx, 100.0);
+                }
+                else {
+                    connection conn(CONNECTION_STRING);
+                    read_transaction tx(conn);
+                    tx.exec_params(COUNT_ORDERS_OVER.sql, 100.0);
+                }
+            }
+            catch (const exception& e) {
+                if (failures++ == 0)
+                    cerr << "Request failed: " << e.what() << endl;
+            }
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back(worker);
+    for (auto& w : workers)
+        w.join();
+    double seconds = seconds_since(start);
+
+    cout << (pool ? "pooled:     " : "unpooled:   ") << fixed << setprecision(0) << requests / seconds
+        << " requests/s (" << threads << " threads, " << requests << " requests, " << failures << " failed)\n";
+}
+
+// Assertions of the --self-check mode. Every check prints one ok/FAIL line; the checks
+// run against the live database on one pooled connection and name their rows with a
+// per-run tag, so reruns and concurrent runs do not collide.
+class SelfCheck {
+public:
+    explicit SelfCheck(ConnectionPool& pool)
+        : conn(pool.acquire()), tag(to_string(chrono::system_clock::now().time_since_epoch().count())) {}
+
+    void check(bool ok, const string& what) {
+        cout << (ok ? "  ok    " : "  FAIL  ") << what << "\n";
+        failure_count += !ok;
+    }
+
+    int failures() const { return failure_count; }
+    connection& db() { return *conn; }
+    string email(const string& name) const { return "selfcheck-" + tag + "-" + name + "@example.com"; }
+
+private:
+    ConnectionPool::Lease conn;
+    const string tag;
+    int failure_count = 0;
+};
+
+// UserIdCache must not serve an id for an email that was changed by another
+// transaction: a user is cached, its email is UPDATEd and committed elsewhere, and
+// once the notification is in, the old email must miss. Commits its user and deletes
+// it afterwards.
+void self_check_cache(SelfCheck& sc) {
+    // Notifications arrive asynchronously, so waits are bounded polls
+    auto wait_for = [](const function<bool()>& done) {
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+        while (!done() && chrono::steady_clock::now() < deadline)
+            this_thread::sleep_for(chrono::milliseconds(10));
+        return done();
+    };
+
+    cout << "\nuser id cache (stale read after UPDATE):\n";
+    UserIdCache cache(16, CONNECTION_STRING);
+    // The listener clears the cache once LISTEN is in place
+    sc.check(wait_for([&] { return cache.clears() > 0; }), "listener subscribed");
+
+    const string email = sc.email("cache");
+    const string renamed = sc.email("cache-renamed");
+    int id;
+    {
+        work tx(sc.db());
+        id = tx.exec_params("INSERT INTO users (name, email) VALUES ('Self check', $1) RETURNING id", email)[0][0].as<int>();
+        tx.commit();
+    }
+    {
+        read_transaction tx(sc.db());
+        optional<int> first = cache.lookup(tx, email);
+        optional<int> second = cache.lookup(tx, email);
+        tx.commit();
+        sc.check(first == id && cache.misses() == 1, "first lookup misses and returns the id");
+        sc.check(second == id && cache.hits() == 1, "second lookup is served from the cache");
+    }
+    size_t invalidations = cache.invalidations(), clears = cache.clears();
+    {
+        work tx(sc.db());
+        tx.exec_params("UPDATE users SET email = $1 WHERE id = $2", renamed, id);
+        tx.commit();
+    }
+    sc.check(wait_for([&] { return cache.invalidations() > invalidations; }), "UPDATE of the email is notified");
+    // A reconnect of the listener would also clear the cache and hide a missing notification
+    sc.check(cache.clears() == clears, "the cache was not cleared in between");
+    {
+        read_transaction tx(sc.db());
+        optional<int> old_email = cache.lookup(tx, email);
+        optional<int> new_email = cache.lookup(tx, renamed);
+        tx.commit();
+        sc.check(!old_email, "old email no longer resolves");
+        sc.check(new_email == id, "new email resolves to the same id");
+    }
+    work tx(sc.db());
+    tx.exec_params("DELETE FROM users WHERE id = $1", id);
+    tx.commit();
+}
+
+// Walking fetch_orders_page must return every order over the threshold exactly once,
+// also when page boundaries fall inside a run of equal amounts, and malformed tokens
+// must be rejected on the client. Runs in a transaction that is rolled back.
+void self_check_pages(SelfCheck& sc) {
+    cout << "keyset pagination (no id repeated or skipped):\n";
+    work tx(sc.db());
+    const double threshold = 9000;
+    int user = tx.exec_params("INSERT INTO users (name, email) VALUES ('Self check', $1) RETURNING id",
+        sc.email("pages"))[0][0].as<int>();
+    // Few distinct amounts, so most page boundaries fall inside a run of equal amounts
+    for (int i = 0; i < 24; ++i)
+        INSERT_ORDER(tx, user, "Self check", threshold + 1 + i % 4);
+
+    set<int> expected;
+    for (auto row : tx.exec_params("SELECT id FROM orders WHERE amount > $1", threshold))
+        expected.insert(row[0].as<int>());
+    for (int page_size : { 1, 4, 5, 7 }) {
+        set<int> seen;
+        bool repeated = false;
+        string token;
+        // A token that does not advance would loop forever; more pages than ids is a failure too
+        for (size_t pages = 0; pages <= expected.size(); ++pages) {
+            OrdersPage page = fetch_orders_page(tx, threshold, page_size, token);
+            for (auto row : page.rows)
+                repeated |= !seen.insert(row["id"].as<int>()).second;
+            token = page.next_token;
+            if (token.empty())
+                break;
+        }
+        sc.check(!repeated && token.empty() && seen == expected, "page size " + to_string(page_size) + ": "
+            + to_string(seen.size()) + " of " + to_string(expected.size()) + " ids, none repeated");
+    }
+    for (const char* token : { "-/5", "./1", "5/", "5/x" }) {
+        bool rejected = false;
+        try {
+            fetch_orders_page(tx, threshold, 4, token);
+        }
+        catch (const invalid_argument&) {
+            rejected = true;
+        }
+        sc.check(rejected, string("malformed token \"") + token + "\" is rejected");
     }
 }
 
-int main() {
+// bulk_upsert_users must report how many rows it inserted or updated, resolve an email
+// repeated within a batch to its last occurrence, and with ConflictPolicy::Update leave
+// rows whose name does not change alone. Runs in a transaction that is rolled back.
+void self_check_upsert(SelfCheck& sc) {
+    cout << "bulk upsert counts:\n";
+    work tx(sc.db());
+    const string existing = sc.email("upsert-existing");
+    const string a = sc.email("upsert-a");
+    const string b = sc.email("upsert-b");
+    const string c = sc.email("upsert-c");
+    tx.exec_params("INSERT INTO users (name, email) VALUES ('Existing', $1)", existing);
+    auto upsert = [&](vector<UserRecord> batch, ConflictPolicy policy) {
+        size_t i = 0;
+        return bulk_upsert_users(tx, [&](UserRecord& user) {
+            if (i == batch.size())
+                return false;
+            user = batch[i++];
+            return true;
+        }, policy);
+    };
+    auto name_of = [&](const string& email) {
+        return tx.exec_params("SELECT name FROM users WHERE email = $1", email)[0][0].as<string>();
+    };
+    // Every UPDATE writes a new row version, so an unchanged ctid means the row was not touched
+    auto version_of = [&](const string& email) {
+        return tx.exec_params("SELECT ctid::text FROM users WHERE email = $1", email)[0][0].as<string>();
+    };
+
+    IngestStats skip = upsert({ { "A1", a }, { "Renamed", existing }, { "B", b }, { "A2", a } }, ConflictPolicy::Skip);
+    sc.check(skip.streamed == 4 && skip.merged == 2, "skip: 4 streamed, 2 merged (got "
+        + to_string(skip.streamed) + ", " + to_string(skip.merged) + ")");
+    sc.check(name_of(existing) == "Existing", "skip: existing user left alone");
+    sc.check(name_of(a) == "A2", "skip: last duplicate in the batch wins");
+
+    const string a_version = version_of(a);
+    IngestStats update = upsert({ { "Renamed", existing }, { "A2", a }, { "C", c }, { "Renamed again", existing } },
+        ConflictPolicy::Update);
+    sc.check(update.streamed == 4 && update.merged == 2, "update: 4 streamed, 2 merged (got "
+        + to_string(update.streamed) + ", " + to_string(update.merged) + ")");
+    sc.check(name_of(existing) == "Renamed again", "update: last duplicate in the batch wins");
+    sc.check(version_of(a) == a_version, "update: unchanged row is not rewritten");
+}
+
+// Runs the --self-check assertions and returns the number that failed
+int run_self_check(ConnectionPool& pool) {
+    SelfCheck sc(pool);
+    self_check_cache(sc);
+    self_check_pages(sc);
+    self_check_upsert(sc);
+    cout << (sc.failures() ? to_string(sc.failures()) + " self-check(s) failed" : string("all self-checks passed")) << "\n";
+    return sc.failures();
+}
+
+const char* const USAGE = R"(Usage: database_connection [--concurrency threads [requests]]
+                           [--import-users users.csv] [--import-orders orders.csv]
+                           [--bulk-demo orders] [--on-conflict skip|update]
+                           [--report threshold [output file]]
+                           [--cache-demo orders [cache capacity]]
+                           [--async-reports [workers]]
+                           [--batch-fetch users]
+                           [--pages page_size [threshold]]
+                           [--self-check])";
+
+int main(int argc, char* argv[]) {
+    int concurrency = 0, requests = 1000;
+    string users_csv, orders_csv;
+    bool report = false;
+    double report_threshold = 0;
+    string report_path;
+    int cache_orders = 0;
+    size_t cache_capacity = 1024;
+    size_t report_workers = 0;
+    int batch_users = 0;
+    int page_size = 0;
+    double page_threshold = 100.0;
+    size_t bulk_orders = 0;
+    ConflictPolicy policy = ConflictPolicy::Skip;
+    bool self_check = false;
+
+    // Option values must be numbers in full, e.g. "--pages 10x" is an error, not 10 or 0
+    auto number = [](const string& option, const char* text) {
+        char* end = nullptr;
+        double value = strtod(text, &end);
+        if (end == text || *end != '\0' || !isfinite(value))
+            throw invalid_argument("invalid value '" + string(text) + "' for " + option);
+        return value;
+    };
+    auto count = [](const string& option, const char* text) {
+        char* end = nullptr;
+        errno = 0;
+        long long value = strtoll(text, &end, 10);
+        if (end == text || *end != '\0' || errno == ERANGE || value < 1 || value > numeric_limits<int>::max())
+            throw invalid_argument("invalid value '" + string(text) + "' for " + option);
+        return static_cast<int>(value);
+    };
     try {
-        connection conn("host=localhost port=5432 dbname=master_thesis user=postgres password=9");
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            auto value = [&] {
+                if (i + 1 >= argc)
+                    throw invalid_argument(arg + " expects a value");
+                return argv[++i];
+            };
+            // The optional second value of an option is anything that is not another option
+            auto has_optional = [&] { return i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0; };
 
-        if (!conn.is_open()) {
-            cerr << "Cannot connect to database!\n";
-            return 1;
+            if (arg == "--concurrency") {
+                concurrency = count(arg, value());
+                if (has_optional())
+                    requests = count(arg, argv[++i]);
+            }
+            else if (arg == "--import-users")
+                users_csv = value();
+            else if (arg == "--import-orders")
+                orders_csv = value();
+            else if (arg == "--bulk-demo")
+                bulk_orders = count(arg, value());
+            else if (arg == "--on-conflict") {
+                string policy_name = value();
+                if (policy_name != "skip" && policy_name != "update")
+                    throw invalid_argument("--on-conflict expects skip or update");
+                policy = policy_name == "update" ? ConflictPolicy::Update : ConflictPolicy::Skip;
+            }
+            else if (arg == "--report") {
+                report = true;
+                report_threshold = number(arg, value());
+                if (has_optional())
+                    report_path = argv[++i];
+            }
+            else if (arg == "--async-reports") {
+                report_workers = size(REPORTS);
+                if (has_optional())
+                    report_workers = count(arg, argv[++i]);
+            }
+            else if (arg == "--pages") {
+                page_size = count(arg, value());
+                if (has_optional())
+                    page_threshold = number(arg, argv[++i]);
+            }
+            else if (arg == "--batch-fetch")
+                batch_users = count(arg, value());
+            else if (arg == "--cache-demo") {
+                cache_orders = count(arg, value());
+                if (has_optional())
+                    cache_capacity = count(arg, argv[++i]);
+            }
+            else if (arg == "--self-check")
+                self_check = true;
+            else
+                throw invalid_argument((arg[0] == '-' ? "unknown option " : "unexpected argument ") + arg);
         }
+    }
+    catch (const invalid_argument& e) {
+        cerr << "Error: " << e.what() << "\n" << USAGE << endl;
+        return 1;
+    }
 
-        work tx(conn);
-        setup_schema(tx);
-        insert_sample_data(tx);
-        tx.commit(); // commit, setup + insert
+    int status = 0;
 
-        work tx2(conn); // new tran for SELECT
-        query_and_process(tx2);
-        tx2.commit();
+    try {
+        {
+            // Statements can only be prepared once the tables exist
+            connection conn(CONNECTION_STRING);
+            work tx(conn);
+            setup_schema(tx);
+            tx.commit();
+        }
+
+        ConnectionPool::Options options;
+        options.max_size = max<size_t>(options.max_size, concurrency);
+        options.on_connect = prepare_statements;
+        ConnectionPool pool(CONNECTION_STRING, options);
+
+        {
+            ConnectionPool::Lease conn = pool.acquire();
+            work tx(*conn);
+            insert_sample_data(tx);
+            tx.commit(); // commit insert
+
+            work tx2(*conn); // new tran for SELECT
+            query_and_process(tx2);
+            tx2.commit();
+        }
+
+        if (!users_csv.empty() || !orders_csv.empty() || bulk_orders > 0) {
+            ConnectionPool::Lease conn = pool.acquire();
+            work tx(*conn, "bulk ingest");
+            cout << "\n";
+            if (!users_csv.empty() || !orders_csv.empty())
+                import_csv(tx, users_csv, orders_csv, policy);
+            if (bulk_orders > 0)
+                bulk_demo(tx, bulk_orders, policy);
+            tx.commit();
+        }
+
+        if (cache_orders > 0) {
+            static const char* const EMAILS[] = { "alice@example.com", "bartek@example.com", "celina@example.com" };
+            UserIdCache cache(cache_capacity, CONNECTION_STRING);
+            ConnectionPool::Lease conn = pool.acquire();
+            work tx(*conn, "cache demo");
+            int placed = 0;
+            for (int i = 0; i < cache_orders; ++i)
+                placed += place_order(tx, cache, EMAILS[i % size(EMAILS)], "Cable", 15.00);
+            tx.commit();
+            cout << "\nplaced " << placed << " orders\n";
+            cache.print_stats(cout);
+        }
+
+        if (report_workers > 0)
+            run_async_reports(pool, report_workers);
+
+        if (batch_users > 0)
+            compare_batched_fetch(pool, batch_users);
+
+        if (page_size > 0) {
+            ConnectionPool::Lease conn = pool.acquire();
+            read_transaction tx(*conn);
+            cout << "\n";
+            walk_order_pages(tx, page_threshold, page_size);
+            tx.commit();
+        }
+
+        if (report) {
+            ofstream file;
+            if (!report_path.empty()) {
+                file.open(report_path, ios::binary);
+                if (!file)
+                    throw runtime_error("cannot open " + report_path);
+            }
+            ConnectionPool::Lease conn = pool.acquire();
+            read_transaction tx(*conn);
+            auto start = chrono::steady_clock::now();
+            size_t rows = stream_orders_report(tx, report_threshold, report_path.empty() ? cout : file);
+            double seconds = seconds_since(start);
+            tx.commit();
+            cerr << "report: " << rows << " orders over " << report_threshold << " in " << fixed << setprecision(2)
+                << seconds << " s (" << setprecision(0) << (seconds > 0 ? rows / seconds : 0) << " rows/s)" << endl;
+        }
+
+        if (concurrency > 0) {
+            cout << "\n";
+            run_concurrent_requests(&pool, concurrency, requests);
+            run_concurrent_requests(nullptr, concurrency, requests);
+        }
 
+        if (self_check && run_self_check(pool) > 0)
+            status = 1;
     }
     catch (const std::exception& e) {
         cerr << "Error: " << e.what() << endl;
+        status = 1;
     }
 
-    return 0;
+    return status;
 }